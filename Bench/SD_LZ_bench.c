@@ -0,0 +1,266 @@
+/**
+ * File: SD_LZ_bench.c
+ * Description: Host benchmark of the compressed stream layer (SD_LZStream.c) over a RAM card, reports compression ratio, stream speed and effective write throughput at a given SPI clock, round trip, seek, stale frames and write retry are verified.
+ * Build : gcc -O2 -std=gnu11 -IInc -D'SD_LZ_CYCLES()=0U' -D'SD_LZ_CYCLES_INIT()=do{}while(0U)' Bench/SD_LZ_bench.c Src/SD_LZStream.c Src/SD_LZ.c -o sd_lz_bench
+ * Usage : ./sd_lz_bench [spi_clock_hz]
+ * Version: 1.0
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<time.h>
+#include "SD_LZStream.h"
+
+
+#define BENCH_DATA_SIZE		(1024*1024)
+#define BENCH_CARD_SECTORS	(2*BENCH_DATA_SIZE/SD_BLOCK_SIZE)	// stored frames carry less than a sector of data.
+#define BENCH_CHUNK			100		// bytes per SD_LZ_Write() call, like a logger appending records.
+#define BENCH_ROUNDS		20
+#define BENCH_RETRIES		4
+#define BENCH_FUZZ_CASES	20000
+
+static uint8_t card[BENCH_CARD_SECTORS*SD_BLOCK_SIZE];
+static uint32_t card_fail;		// number of upcoming block writes to be failed.
+static uint8_t data[BENCH_DATA_SIZE];
+static uint8_t decoded[BENCH_DATA_SIZE];
+static sd_lz_writer writer;
+static sd_lz_reader reader;
+static sd_lz_hash ht;
+static uint32_t stream_id;
+static uint32_t lcg=12345;
+
+/**
+ * @brief RAM card replacing the block read of SD_SPI.c.
+ * @param uint32_t sector passes the index of the sector to be read.
+ * @param uint8_t* buffer passes the pointer to SD_BLOCK_SIZE bytes of memory where the block has to be stored.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_CMD for a sector out of the card.
+ */
+uint8_t SD_ReadBlock(uint32_t sector, uint8_t* buffer){
+	if(sector>=BENCH_CARD_SECTORS){
+		return SD_ERR_CMD;
+	}
+	memcpy(buffer,&card[sector*SD_BLOCK_SIZE],SD_BLOCK_SIZE);
+	return SD_OK;
+}
+
+/**
+ * @brief RAM card replacing the block write of SD_SPI.c, fails card_fail writes without touching the card.
+ * @param uint32_t sector passes the index of the first sector to be written.
+ * @param uint8_t* buffer passes the pointer to count*SD_BLOCK_SIZE bytes of data to be written.
+ * @param uint16_t count passes the number of blocks to be written.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_WRITE for an injected failure else SD_ERR_CMD for sectors out of the card.
+ */
+uint8_t SD_WriteBlocks(uint32_t sector, uint8_t* buffer, uint16_t count){
+	if(card_fail>0){
+		card_fail--;
+		return SD_ERR_WRITE;
+	}
+	if(sector+count>BENCH_CARD_SECTORS){
+		return SD_ERR_CMD;
+	}
+	memcpy(&card[sector*SD_BLOCK_SIZE],buffer,(uint32_t)count*SD_BLOCK_SIZE);
+	return SD_OK;
+}
+
+/**
+ * @brief deterministic pseudo random generator.
+ * @param void
+ * @retval uint32_t returns the next value.
+ */
+static uint32_t bench_rand(void){
+	lcg=lcg*1103515245U+12345U;
+	return lcg>>8;
+}
+
+/**
+ * @brief monotonic time in seconds.
+ * @param void
+ * @retval double returns the time.
+ */
+static double bench_now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec+(double)ts.tv_nsec*1e-9;
+}
+
+/**
+ * @brief writes the data as a new stream at sector 0 in chunks of BENCH_CHUNK bytes, after a failed write the bytes not taken are passed again.
+ * @param uint32_t len passes the size of the data in bytes.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the write failing after BENCH_RETRIES retries.
+ */
+static uint8_t bench_write(uint32_t len){
+	uint32_t pos=0;
+	uint8_t retries=0;
+	uint8_t status;
+
+	SD_LZ_WriterInit(&writer,0,++stream_id);
+	while(pos<len){
+		uint32_t n=(len-pos<BENCH_CHUNK)?len-pos:BENCH_CHUNK;
+		uint32_t taken;
+		status=SD_LZ_Write(&writer,&data[pos],n,&taken);
+		pos+=taken;
+		if(status!=SD_OK && retries++==BENCH_RETRIES){
+			return status;
+		}
+	}
+	do{
+		status=SD_LZ_Flush(&writer);
+	}while(status!=SD_OK && retries++<BENCH_RETRIES);
+	return status;
+}
+
+/**
+ * @brief reads the stream at sector 0 to its end.
+ * @param void
+ * @retval uint32_t returns the number of bytes read, 0 on a read error.
+ */
+static uint32_t bench_read(void){
+	uint32_t got;
+	if(SD_LZ_ReaderInit(&reader,0)!=SD_OK || SD_LZ_Read(&reader,decoded,BENCH_DATA_SIZE,&got)!=SD_OK){
+		return 0;
+	}
+	return got;
+}
+
+/**
+ * @brief seeks to every frame of the stream at sector 0 and checks its data against the source.
+ * @param uint32_t len passes the size of the data in bytes.
+ * @retval int returns 0 on success, 1 on first failure.
+ */
+static int bench_seek(uint32_t len){
+	uint32_t pos=0;
+
+	for(uint32_t frame=0;frame<writer.frame;frame++){
+		if(SD_LZ_Seek(&reader,frame)!=SD_OK || pos+reader.raw_len>len || memcmp(reader.raw,&data[pos],reader.raw_len)!=0){
+			printf("seek to frame %u failed\n",frame);
+			return 1;
+		}
+		pos+=reader.raw_len;
+	}
+	if(pos!=len || SD_LZ_Seek(&reader,writer.frame)!=SD_ERR_FRAME){
+		printf("seek past end of stream failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief benchmarks one data set through the stream layer and prints the report.
+ * @param const char* name passes the name of the data set.
+ * @param uint32_t len passes the size of the data in bytes.
+ * @param double link passes the SPI link throughput in bytes/s.
+ * @retval int returns 0 on success, 1 if round trip or seek failed.
+ */
+static int bench_run(const char* name, uint32_t len, double link){
+	uint8_t status=SD_OK;
+	double start=bench_now();
+	for(uint8_t r=0;r<BENCH_ROUNDS;r++){
+		status|=bench_write(len);
+	}
+	double comp=(bench_now()-start)/BENCH_ROUNDS;
+
+	uint32_t out=0;
+	start=bench_now();
+	for(uint8_t r=0;r<BENCH_ROUNDS;r++){
+		out=bench_read();
+	}
+	double decomp=(bench_now()-start)/BENCH_ROUNDS;
+
+	int ok=(status==SD_OK && writer.stats.raw_bytes==len && out==len && memcmp(data,decoded,len)==0);
+	ok=ok && bench_seek(len)==0;
+	double card_bytes=(double)writer.stats.card_bytes;
+	double ratio=(double)len/card_bytes;
+
+	// compression and SPI transfer in sequence, as done by SD_LZ_Write() without DMA.
+	double effective=(double)len/(comp+card_bytes/link);
+
+	printf("%-10s raw %u card %.0f ratio %.2fx frames %u | write %.1f MB/s read %.1f MB/s | link %.2f MB/s effective %.2f MB/s | round trip %s\n",
+		name,len,card_bytes,ratio,writer.stats.frames,len/comp/1e6,len/decomp/1e6,link/1e6,effective/1e6,ok?"OK":"FAIL");
+	return ok?0:1;
+}
+
+/**
+ * @brief writes a long stream then a short one at the same sector with failed block writes in between, the reader must return the short one only.
+ * @param void
+ * @retval int returns 0 on success, 1 on failure.
+ */
+static int bench_stale(void){
+	uint32_t len=BENCH_DATA_SIZE/4;
+	uint32_t got=0;
+
+	bench_write(BENCH_DATA_SIZE);
+	card_fail=2;
+	uint8_t status=bench_write(len);
+	uint32_t frames=writer.frame;
+
+	if(card_fail!=0 || status!=SD_OK || writer.stats.raw_bytes!=len || bench_read()!=len || memcmp(data,decoded,len)!=0){
+		printf("stale      FAIL : status %u\n",status);
+		return 1;
+	}
+	// frame past the end is a valid frame of the older stream.
+	if(SD_LZ_Seek(&reader,frames)!=SD_ERR_FRAME || SD_LZ_Read(&reader,decoded,1,&got)!=SD_OK || got!=0){
+		printf("stale      FAIL : older stream read past the end\n");
+		return 1;
+	}
+	printf("stale      %u frames over an older stream, 2 failed writes retried OK\n",frames);
+	return 0;
+}
+
+/**
+ * @brief round trips random mixes of runs, repeats and noise of random sizes through the codec with random output capacities.
+ * @param void
+ * @retval int returns 0 on success, 1 on first failure.
+ */
+static int bench_fuzz(void){
+	static uint8_t src[SD_LZ_RAW_MAX];
+	static uint8_t dst[SD_LZ_RAW_MAX+64];
+	static uint8_t back[SD_LZ_RAW_MAX];
+
+	for(uint32_t c=0;c<BENCH_FUZZ_CASES;c++){
+		uint16_t len=(uint16_t)(bench_rand()%(SD_LZ_RAW_MAX+1));
+		uint16_t cap=(uint16_t)(1+bench_rand()%(SD_LZ_FRAME_PAYLOAD+64));
+		uint32_t mode=bench_rand()%4;
+
+		for(uint16_t i=0;i<len;i++){
+			switch(mode){
+				case 0 :	src[i]=(uint8_t)bench_rand();				break;
+				case 1 :	src[i]=(uint8_t)(bench_rand()%4);			break;
+				case 2 :	src[i]=(i>8 && bench_rand()%8)?src[i-1-bench_rand()%8]:(uint8_t)bench_rand();	break;
+				default :	src[i]=(uint8_t)(i/64);						break;
+			}
+		}
+
+		uint16_t consumed;
+		uint16_t plen=SD_LZ_Compress(&ht,src,len,dst,cap,&consumed);
+		if(plen>cap || consumed>len || SD_LZ_Decompress(dst,plen,back,sizeof(back))!=consumed || memcmp(src,back,consumed)!=0){
+			printf("fuzz case %u failed : len %u cap %u mode %u\n",c,len,cap,mode);
+			return 1;
+		}
+	}
+	printf("fuzz       %u cases OK\n",BENCH_FUZZ_CASES);
+	return 0;
+}
+
+int main(int argc, char** argv){
+	double spi_hz=(argc>1)?atof(argv[1]):21e6;
+	double link=spi_hz/8.0;
+	int fail=0;
+	uint32_t len=0;
+	uint32_t t=0;
+
+	// telemetry : CSV records of a timestamp and slowly varying channels.
+	while(len+48<=BENCH_DATA_SIZE){
+		len+=(uint32_t)sprintf((char*)&data[len],"T=%08u,A=%d,B=%d,C=%d\n",t,(int)(bench_rand()%50),(int)(1000+bench_rand()%10),(int)(t/1000));
+		t+=10;
+	}
+	fail|=bench_run("telemetry",len,link);
+
+	for(uint32_t i=0;i<BENCH_DATA_SIZE;i++){
+		data[i]=(uint8_t)bench_rand();
+	}
+	fail|=bench_run("random",BENCH_DATA_SIZE,link);
+
+	fail|=bench_stale();
+	fail|=bench_fuzz();
+	return fail;
+}
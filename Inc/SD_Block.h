@@ -0,0 +1,47 @@
+#ifndef SD_BLOCK_H
+#define SD_BLOCK_H
+
+    /**
+     * File: SD_Block.h
+     * Description: This header file contains the block size, exit status and declarations of the block IO routines, does not depend on HAL so that layers above the block IO (e.g. SD_LZStream) can be built on the host.
+     * Version: 1.0
+     * Architecture : Little Endian
+     */
+
+
+
+#include<stdint.h>
+
+
+#define SD_BLOCK_SIZE			512
+
+/**
+ * @brief exit status of the block IO routines.
+ */
+#define SD_OK			0x00
+#define SD_ERR_CMD		0x01	// command failed or card returned non-zero R1.
+#define SD_ERR_TOKEN	0x02	// data error token or no start token in time.
+#define SD_ERR_CRC		0x03	// CRC16 mismatch on received block.
+#define SD_ERR_WRITE	0x04	// data response other than accepted.
+#define SD_ERR_BUSY		0x05	// card did not release busy in time.
+
+/**
+ * @brief Reads a single block (CMD17) and verifies its CRC16, selects and de-selects the chip itself.
+ * @param uint32_t sector passes the index of the sector to be read.
+ * @param uint8_t* buffer passes the pointer to SD_BLOCK_SIZE bytes of memory where the block has to be stored.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_ReadBlock(uint32_t sector, uint8_t* buffer);
+
+/**
+ * @brief Writes consecutive blocks, single block write (CMD24) for one block else multiple block write (CMD25), selects and de-selects the chip itself.
+ * @param uint32_t sector passes the index of the first sector to be written.
+ * @param uint8_t* buffer passes the pointer to count*SD_BLOCK_SIZE bytes of data to be written.
+ * @param uint16_t count passes the number of blocks to be written.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_WriteBlocks(uint32_t sector, uint8_t* buffer, uint16_t count);
+
+
+
+#endif /* SD_BLOCK_H */
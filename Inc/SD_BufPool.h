@@ -0,0 +1,85 @@
+#ifndef SD_BUFPOOL_H
+#define SD_BUFPOOL_H
+
+    /**
+     * File: SD_BufPool.h
+     * Description: This header file contains the declarations of the static sector buffer pool, buffers are DMA/cache-line aligned and are passed between layers by ownership hand-off instead of copies.
+     * Version: 1.0
+     * Architecture : Little Endian
+     */
+
+
+
+#include<stdint.h>
+#include<string.h>
+#include "SD_SPI.h"
+
+
+/**
+ * @brief macros for pool configuration.
+ */
+#define SD_POOL_SLOTS	8		// number of sector buffers, at most 32 (one bit of the free mask per slot), need to be modified by programmer.
+#define SD_POOL_ALIGN	32		// cache line size of Cortex-M7, also satisfies DMA alignment, must be power of 2.
+#define SD_POOL_SECTION			// place pool in DMA capable RAM e.g. __attribute__((section(".sram1"))), need to be modified by programmer.
+
+/**
+ * @brief owners of a sector buffer, only the current owner can hand off or release the buffer.
+ */
+#define SD_BUF_FREE		0x00
+#define SD_BUF_APP		0x01	// application is filling or consuming the buffer.
+#define SD_BUF_CACHE	0x02	// buffer is held by a cache layer.
+#define SD_BUF_XFER		0x03	// buffer is owned by the transfer (SPI/DMA) layer.
+
+/**
+ * @brief exit status of the pool routines, in addition to SD_OK.
+ */
+#define SD_ERR_OWNER	0x20	// buffer is not from the pool or caller is not its owner.
+
+/**
+ * @brief Takes a free sector buffer from the pool, lock-free and O(1).
+ * @param uint8_t owner passes the owner (SD_BUF_xx other than SD_BUF_FREE) taking the buffer.
+ * @retval uint8_t* returns the pointer to SD_BLOCK_SIZE bytes aligned to SD_POOL_ALIGN, NULL if pool is exhausted.
+ */
+uint8_t* SD_BufGet(uint8_t owner);
+
+/**
+ * @brief Returns a sector buffer to the pool, lock-free and O(1).
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @param uint8_t owner passes the current owner of the buffer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_OWNER.
+ */
+uint8_t SD_BufPut(uint8_t* buf, uint8_t owner);
+
+/**
+ * @brief Hands the ownership of a sector buffer to another layer without copying its contents.
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @param uint8_t from passes the current owner of the buffer.
+ * @param uint8_t to passes the new owner (SD_BUF_xx other than SD_BUF_FREE) of the buffer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_OWNER.
+ */
+uint8_t SD_BufHandOff(uint8_t* buf, uint8_t from, uint8_t to);
+
+/**
+ * @brief Tells the current owner of a sector buffer.
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @retval uint8_t returns the owner SD_BUF_xx, SD_BUF_FREE for buffers not from the pool.
+ */
+uint8_t SD_BufOwner(uint8_t* buf);
+
+/**
+ * @brief Tells the number of buffers currently taken from the pool.
+ * @param void
+ * @retval uint8_t returns the number of buffers in use.
+ */
+uint8_t SD_BufInUse(void);
+
+/**
+ * @brief Tells the largest number of buffers ever in use at the same time, used to size SD_POOL_SLOTS tightly.
+ * @param void
+ * @retval uint8_t returns the high-water mark.
+ */
+uint8_t SD_BufHighWater(void);
+
+
+
+#endif /* SD_BUFPOOL_H */
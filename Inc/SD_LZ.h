@@ -0,0 +1,57 @@
+#ifndef SD_LZ_H
+#define SD_LZ_H
+
+    /**
+     * File: SD_LZ.h
+     * Description: This header file contains the declarations of the LZ4-class block codec used by the compressed stream layer, codec does not depend on HAL and uses caller provided work memory only.
+     * Version: 1.0
+     * Architecture : Little Endian
+     */
+
+
+
+#include<stdint.h>
+#include<string.h>
+
+
+/**
+ * @brief macros for codec tuning.
+ */
+#define SD_LZ_HASH_BITS		10		// hash table of (1<<SD_LZ_HASH_BITS) entries, 2 bytes each.
+#define SD_LZ_HASH_SIZE		(1<<SD_LZ_HASH_BITS)
+#define SD_LZ_MIN_MATCH		4
+#define SD_LZ_MAX_OFFSET	0xFFFF
+#define SD_LZ_RUN_MASK		0x0F	// nibble value signaling that extension bytes follow.
+
+/**
+ * @brief sd_lz_hash is the fixed-size work memory of the compressor, holds (position+1) of the last occurence of each hash, 0 for empty slot.
+ */
+typedef struct{
+	uint16_t slot[SD_LZ_HASH_SIZE];
+} sd_lz_hash;
+
+/**
+ * @brief Compresses as much of the source as fits in the destination, sequences are in LZ4 block format (token, literals, 2 byte offset, extension bytes).
+ * @param sd_lz_hash* ht passes the pointer to the work memory, cleared by this routine.
+ * @param const uint8_t* src passes the pointer to the data to be compressed.
+ * @param uint16_t src_len passes the size of the data in bytes.
+ * @param uint8_t* dst passes the pointer to the memory region where the compressed data has to be stored.
+ * @param uint16_t dst_cap passes the size of the destination in bytes.
+ * @param uint16_t* consumed returns the number of source bytes encoded into the destination.
+ * @retval uint16_t returns the size of the compressed data in bytes.
+ */
+uint16_t SD_LZ_Compress(sd_lz_hash* ht, const uint8_t* src, uint16_t src_len, uint8_t* dst, uint16_t dst_cap, uint16_t* consumed);
+
+/**
+ * @brief Decompresses data produced by SD_LZ_Compress, every offset and length is bound checked.
+ * @param const uint8_t* src passes the pointer to the compressed data.
+ * @param uint16_t src_len passes the size of the compressed data in bytes.
+ * @param uint8_t* dst passes the pointer to the memory region where the decompressed data has to be stored.
+ * @param uint16_t dst_cap passes the size of the destination in bytes.
+ * @retval uint16_t returns the size of the decompressed data in bytes, 0 for corrupt input.
+ */
+uint16_t SD_LZ_Decompress(const uint8_t* src, uint16_t src_len, uint8_t* dst, uint16_t dst_cap);
+
+
+
+#endif /* SD_LZ_H */
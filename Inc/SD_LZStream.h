@@ -0,0 +1,167 @@
+#ifndef SD_LZSTREAM_H
+#define SD_LZSTREAM_H
+
+    /**
+     * File: SD_LZStream.h
+     * Description: This header file contains the frame format, structures and routine declarations of the optional compressed stream layer above the block IO routines.
+     * Version: 1.0
+     * Architecture : Little Endian
+     */
+
+
+
+#include<stdint.h>
+#include<string.h>
+#include "SD_Block.h"
+#include "SD_LZ.h"
+
+
+/**
+ * @brief macros for frame format, every frame occupies exactly one sector : <header> | <payload>.
+ * header : <magic:1> | <flags:1> | <raw_len:2> | <payload_len:2> | <stream_id:4> | <seq:4>, multi-byte fields are little endian.
+ * stream_id tells frames of this stream from stale frames of an older stream at the same base sector, seq is the frame index.
+ */
+#define SD_LZ_FRAME_MAGIC		0xC5
+#define SD_LZ_FRAME_HDR_SIZE	0x0E
+#define SD_LZ_FRAME_PAYLOAD		(SD_BLOCK_SIZE-SD_LZ_FRAME_HDR_SIZE)
+#define SD_LZ_FLAG_STORED		0x01	// payload holds raw data, data did not compress.
+
+/**
+ * @brief macros for stream tuning.
+ */
+#define SD_LZ_RAW_MAX			(4*SD_BLOCK_SIZE)	// largest raw data carried by a frame, bounds the ratio at 4x.
+#define SD_LZ_BATCH_FRAMES		4					// frames written per multiple block write.
+
+/**
+ * @brief cycle counter of the statistics i.e. DWT CYCCNT of Cortex-M3 and above, need to be modified by programmer for other cores.
+ * defining SD_LZ_CYCLES() and SD_LZ_CYCLES_INIT() beforehand (e.g. on the compiler command line) removes the dependency on HAL.
+ */
+#ifndef SD_LZ_CYCLES
+#include "main.h"
+#define SD_LZ_CYCLES()			(DWT->CYCCNT)
+#define SD_LZ_CYCLES_INIT()		do{										\
+	CoreDebug->DEMCR|=CoreDebug_DEMCR_TRCENA_Msk;						\
+	DWT->CTRL|=DWT_CTRL_CYCCNTENA_Msk;									\
+}while(0U)
+#endif
+
+/**
+ * @brief exit status of the stream routines, in addition to SD_ERR_xx of the block IO routines.
+ */
+#define SD_ERR_FRAME	0x10	// invalid frame header or corrupt payload i.e. end of stream.
+
+/**
+ * @brief structure holding stream statistics in CPU cycles, effective throughput is raw_bytes*SystemCoreClock/(compress_cycles+write_cycles) bytes/s.
+ * @param uint32_t raw_bytes holds the number of bytes accepted from the application.
+ * @param uint32_t card_bytes holds the number of bytes written to the card.
+ * @param uint32_t frames holds the number of frames produced.
+ * @param uint64_t compress_cycles holds the CPU cycles spent in compression.
+ * @param uint64_t write_cycles holds the CPU cycles spent in block writes.
+ */
+typedef struct{
+	uint32_t raw_bytes;
+	uint32_t card_bytes;
+	uint32_t frames;
+	uint64_t compress_cycles;
+	uint64_t write_cycles;
+} sd_lz_stats;
+
+/**
+ * @brief structure holding the state and the entire work memory of a compressed stream writer.
+ * @param uint32_t base_sector holds the sector of frame 0.
+ * @param uint32_t stream_id holds the ID stamped into every frame.
+ * @param uint32_t frame holds the index of the next frame to be produced.
+ * @param uint16_t raw_fill holds the number of raw bytes staged.
+ * @param uint8_t batch_fill holds the number of frames waiting in the batch.
+ * @param sd_lz_hash ht holds the compressor work memory.
+ * @param uint8_t raw[] holds the staged raw data.
+ * @param uint8_t batch[] holds the frames waiting to be written.
+ * @param sd_lz_stats stats holds the stream statistics.
+ */
+typedef struct{
+	uint32_t base_sector;
+	uint32_t stream_id;
+	uint32_t frame;
+	uint16_t raw_fill;
+	uint8_t batch_fill;
+	sd_lz_hash ht;
+	uint8_t raw[SD_LZ_RAW_MAX];
+	uint8_t batch[SD_LZ_BATCH_FRAMES*SD_BLOCK_SIZE];
+	sd_lz_stats stats;
+} sd_lz_writer;
+
+/**
+ * @brief structure holding the state and the entire work memory of a compressed stream reader.
+ * @param uint32_t base_sector holds the sector of frame 0.
+ * @param uint32_t stream_id holds the ID of the stream, taken from frame 0.
+ * @param uint32_t frame holds the index of the next frame to be loaded.
+ * @param uint16_t raw_len holds the number of bytes held in raw[].
+ * @param uint16_t raw_pos holds the read position in raw[].
+ * @param uint8_t sector[] holds the frame read from the card.
+ * @param uint8_t raw[] holds the decompressed frame.
+ */
+typedef struct{
+	uint32_t base_sector;
+	uint32_t stream_id;
+	uint32_t frame;
+	uint16_t raw_len;
+	uint16_t raw_pos;
+	uint8_t sector[SD_BLOCK_SIZE];
+	uint8_t raw[SD_LZ_RAW_MAX];
+} sd_lz_reader;
+
+/**
+ * @brief Initializes a compressed stream writer and enables the cycle counter of the statistics.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @param uint32_t base_sector passes the sector where frame 0 has to be written.
+ * @param uint32_t stream_id passes the ID of the stream e.g. a boot counter or RTC time, must differ from the ID of the stream previously written at base_sector.
+ * @retval void
+ */
+void SD_LZ_WriterInit(sd_lz_writer* w, uint32_t base_sector, uint32_t stream_id);
+
+/**
+ * @brief Appends data to the compressed stream, full batches of frames are written to the card.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @param const uint8_t* data passes the pointer to the data to be appended.
+ * @param uint32_t len passes the size of the data in bytes.
+ * @param uint32_t* taken returns the number of bytes accepted into the stream, the rest has to be passed again after an error.
+ * @retval uint8_t returns SD_OK on success (all of len taken) else SD_ERR_xx of the failed block write.
+ */
+uint8_t SD_LZ_Write(sd_lz_writer* w, const uint8_t* data, uint32_t len, uint32_t* taken);
+
+/**
+ * @brief Compresses the staged data into frames and writes every pending frame to the card.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the failed block write, pending frames are kept and the call can be repeated.
+ */
+uint8_t SD_LZ_Flush(sd_lz_writer* w);
+
+/**
+ * @brief Initializes a compressed stream reader positioned at the start of frame 0, stream ID is taken from frame 0.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint32_t base_sector passes the sector of frame 0.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_FRAME if there is no stream else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_ReaderInit(sd_lz_reader* r, uint32_t base_sector);
+
+/**
+ * @brief Positions the reader at the start of a frame by reading and decompressing it.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint32_t frame passes the index of the frame.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_FRAME past the end of stream or at a frame lost by a failed write else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_Seek(sd_lz_reader* r, uint32_t frame);
+
+/**
+ * @brief Reads decompressed data sequentially, crossing frame boundaries as required.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint8_t* buffer passes the pointer to the memory region where the data has to be stored.
+ * @param uint32_t len passes the number of bytes requested.
+ * @param uint32_t* got returns the number of bytes stored, less than requested at the end of stream.
+ * @retval uint8_t returns SD_OK on success or end of stream else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_Read(sd_lz_reader* r, uint8_t* buffer, uint32_t len, uint32_t* got);
+
+
+
+#endif /* SD_LZSTREAM_H */
@@ -15,6 +15,7 @@
 #include<stdint.h>
 #include<string.h>
 #include "main.h"
+#include "SD_Block.h"
 
 
 /**
@@ -113,6 +114,30 @@
 #define CMD_TYPE_R3		0x08
 #define CMD_TYPE_R7		0x10
 
+/**
+ * @brief Command descriptor flags, tells the command engine what happens on the bus after the response.
+ */
+#define CMD_FLAG_NONE	0x00
+#define CMD_FLAG_BUSY	0x01	// card holds MISO low (busy) after the response until the operation completes (R1b).
+#define CMD_FLAG_STUFF	0x02	// one stuff byte follows the command frame and must be skipped before polling (CMD12).
+#define CMD_FLAG_DATA	0x04	// a data block follows the response, bytes after the response are kept for SD_ReceiveData().
+
+/**
+ * @brief Poll budgets (in bytes) of the command engine.
+ */
+#define CMD_INDEX(_cmd)		((_cmd)&0x3F)	// index of the command in the descriptor table.
+#define CMD_TABLE_SIZE		0x40
+#define CMD_POLL_NCR		0x08	// NCR (command to response) is at most 8 bytes.
+#define CMD_POLL_INIT		0x14	// relaxed budget for commands issued while the card is still waking up.
+#define CMD_RESP_MAX_LEN	0x05	// longest response i.e. R3/R7.
+#define CMD_FRAME_MAX		(0x06+0x01+CMD_POLL_INIT+CMD_RESP_MAX_LEN)	// command + stuff byte + poll window + response.
+
+/**
+ * @brief macros for busy waiting after R1b responses and data writes.
+ */
+#define SD_BUSY_CHUNK		0x10	// bytes clocked per busy poll transaction.
+#define SD_BUSY_TIMEOUT_MS	500		// write/erase busy time is at most 250ms for SDHC/SDXC, kept with margin.
+
 
 /**
  * @brief Command specific macros, basically some default hard-coded values.
@@ -160,6 +185,42 @@
 
 #define DUMMY_BYTE	0xFF
 
+/**
+ * @brief macros for block (sector) IO, block size and exit status are in SD_Block.h.
+ */
+#define TOKEN_START_BLOCK		0xFE	// start token of single block read/write and multiple block read.
+#define TOKEN_START_MULTI_WR	0xFC	// start token of each block of multiple block write.
+#define TOKEN_STOP_TRAN			0xFD	// stop transmission token of multiple block write.
+#define DATA_RESP_MASK			0x1F
+#define DATA_RESP_ACCEPTED		0x05
+#define DATA_RESP_CRC_ERR		0x0B	// data rejected due to CRC error, only while CRC checking is enabled (CMD59).
+#define SD_READ_TIMEOUT_MS		100		// read access time is at most 100ms for SDHC/SDXC.
+
+#if CARD_TYPE == CARD_SDSC
+#define SD_SECTOR_ADDR(_sector)	((uint32_t)(_sector)*SD_BLOCK_SIZE)	// SDSC is byte addressed.
+#else
+#define SD_SECTOR_ADDR(_sector)	((uint32_t)(_sector))					// SDHC/SDXC are block addressed.
+#endif
+
+/**
+ * @brief macros for SPI link calibration.
+ */
+#define SD_LINK_RATES			8		// SPI prescalers 256 down to 2, rate index 0 is the slowest.
+#define SD_CALIB_PASSES			4		// read-verify passes required at each rate.
+#define SD_CALIB_MARGIN			1		// rate steps backed off from the fastest passing rate.
+#define SD_LINK_ERR_THRESHOLD	3		// CRC/token errors within the window that lower the rate at runtime.
+#define SD_LINK_ERR_WINDOW		1024	// blocks after which the error count restarts.
+#define SD_LINK_SPEC_MAX_HZ		50000000	// SPI clock limit of high speed mode.
+#define SD_LINK_DEFAULT_MAX_HZ	25000000	// SPI clock limit of default speed mode, used when CSD is unreadable.
+#define SD_LINK_WRITE_CRC		1		// keep card CRC checking (CMD59) enabled after calibration, costs a CRC16 per written block.
+#define SD_SPI_CLOCK_HZ()		HAL_RCC_GetPCLK1Freq()	// SPI kernel clock (APB1 for SPI2), need to be modified by programmer.
+
+/**
+ * @brief macros for CSD register.
+ */
+#define CSD_SIZE				16
+#define CSD_TRAN_SPEED			3		// byte index of TRAN_SPEED.
+
 /**
  * @defgroups CMD_FORMATTING cmd_formatting
  * @brief command formatting routines are structure required to create a command for data transaction.
@@ -194,6 +255,20 @@ typedef struct{
 	uint8_t r7[5];
 } resp;
 
+/**
+ * @brief cmd_desc structure describes how the command engine has to handle a command on the bus.
+ * @param uint8_t type holds the response type of the command (CMD_TYPE_xx), 0 if command is not supported in SPI mode.
+ * @param uint8_t len holds the response length in bytes.
+ * @param uint8_t flags holds the CMD_FLAG_xx flags of the command.
+ * @param uint8_t poll holds the number of bytes to be polled for the first response byte.
+ */
+typedef struct{
+	uint8_t type;
+	uint8_t len;
+	uint8_t flags;
+	uint8_t poll;
+} cmd_desc;
+
 /**
  * @brief getCRC calculates the CRC7 of a given sequence.
  * @param uint8_t* addr passes the address of the data whose CRC7 has to be calculated.
@@ -250,12 +325,38 @@ void SD_Select(void);
 void SD_Deselect(void);
 
 /**
- * @brief Sends a specific command
+ * @brief Returns the descriptor of a command from the command descriptor table.
+ * @param uint8_t command passes the command value whose descriptor is required.
+ * @retval const cmd_desc* returns the pointer to the descriptor, NULL if command is not supported in SPI mode.
+ */
+const cmd_desc* SD_GetCmdDesc(uint8_t command);
+
+/**
+ * @brief Sends a specific command and captures its response in a single burst transaction, CS is asserted and left asserted for the data phase, caller de-selects the chip.
+ * @param cmd_format* cmd passes the pointer to the command format structure into which the command is casted.
  * @param uint8_t command passes the command value corresponding to the command to be sent.
  * @param uint8_t* arg passes the pointer to the 4 byte argument array.
- * @retval uint8_t* returns the pointer to appropriate buffer in 'resp' structure.
+ * @param resp* respbox passes the pointer to the response box structure.
+ * @retval uint8_t* returns the pointer to appropriate buffer in 'resp' structure, NULL on failure or no response.
+ */
+uint8_t* SendSD_Command(cmd_format* cmd, uint8_t command, uint8_t* arg, resp* respbox);
+
+/**
+ * @brief Waits until the card releases the busy signal (MISO high).  Chip must always be selected before using this routine.
+ * @param uint32_t timeout_ms passes the maximum time in milliseconds to wait.
+ * @retval uint8_t returns 0x00 if card is ready, 0x01 on timeout or bus failure.
  */
-uint8_t* SendSD_Command(cmd_format* cmd, uint8_t command, uint8_t cmd_type, uint8_t* arg, resp* respbox);
+uint8_t SD_WaitReady(uint32_t timeout_ms);
+
+/**
+ * @brief Receives the data block of the last command i.e. waits for the start token, then receives the data and its CRC16.  Bytes already clocked in by the command burst are consumed first.  Chip must always be selected before using this routine.
+ * @param uint8_t* buffer passes the pointer to the memory region where the data has to be stored.
+ * @param uint16_t byte_count passes the size of the data block in bytes.
+ * @param uint16_t* crc16 returns the CRC16 sent by the card.
+ * @param uint32_t timeout_ms passes the maximum time in milliseconds to wait for the start token.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_TOKEN.
+ */
+uint8_t SD_ReceiveData(uint8_t* buffer, uint16_t byte_count, uint16_t* crc16, uint32_t timeout_ms);
 
 /**
  * @brief Transmit specific number of bytes, can be used with data write etc commands to send entire data block.  Chip must always be selected before using this routine.
@@ -288,6 +389,53 @@ void SD_SendDummyBytes(SPI_HandleTypeDef* hspiX, uint16_t num_bytes);
  */
 uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox);
 
+/**
+ * @brief structure holding the state of the SPI link.
+ * @param uint8_t rate holds the index of the SPI prescaler in use, 0 is the slowest.
+ * @param uint8_t max_rate holds the fastest rate found reliable by the calibration.
+ * @param uint8_t min_rate holds the rate at calibration start, link is never lowered below it.
+ * @param uint8_t calibrating tells that calibration is running, runtime back-off is suspended.
+ * @param uint8_t crc_on tells that the card checks CRC of commands and data (CMD59), data blocks are sent with CRC16.
+ * @param uint32_t max_hz holds the highest SPI clock calibration is allowed to try.
+ * @param uint16_t errors holds the CRC/token errors in the current window.
+ * @param uint16_t blocks holds the blocks read or written in the current window.
+ */
+typedef struct{
+	uint8_t rate;
+	uint8_t max_rate;
+	uint8_t min_rate;
+	uint8_t calibrating;
+	uint8_t crc_on;
+	uint32_t max_hz;
+	uint16_t errors;
+	uint16_t blocks;
+} sd_link;
+
+extern sd_link SD_Link;
+
+/**
+ * @brief Selects the SPI prescaler of the link, re-initializes the SPI peripheral.
+ * @param uint8_t rate passes the rate index, 0 is the slowest (prescaler 256) and SD_LINK_RATES-1 the fastest (prescaler 2).
+ * @retval uint8_t returns SD_OK on success else SD_ERR_CMD.
+ */
+uint8_t SD_SetLinkRate(uint8_t rate);
+
+/**
+ * @brief Reads the CSD register (CMD9) and verifies its CRC16, selects and de-selects the chip itself.
+ * @param uint8_t* csd passes the pointer to 16 bytes of memory where the CSD has to be stored.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_ReadCSD(uint8_t* csd);
+
+/**
+ * @brief Finds the fastest reliable SPI clock, must be called after SD_init().  CRC checking is enabled (CMD59) and at every rate up to the card maximum (CSD TRAN_SPEED, SD_LINK_DEFAULT_MAX_HZ if CSD is unreadable) a pattern is written to the scratch sector and read back, first CRC, token or data error stops the search, chosen rate is backed off by SD_CALIB_MARGIN.
+ * @param uint32_t scratch_sector passes the sector which can be overwritten by the calibration.
+ * @param uint8_t* pattern passes the pointer to SD_BLOCK_SIZE bytes of work memory for the test pattern.
+ * @param uint8_t* readback passes the pointer to SD_BLOCK_SIZE bytes of work memory for the read back data.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the CRC enable or pattern write/verify at the starting rate.
+ */
+uint8_t SD_LinkCalibrate(uint32_t scratch_sector, uint8_t* pattern, uint8_t* readback);
+
 
 
 
@@ -0,0 +1,135 @@
+
+#include "SD_BufPool.h"
+
+
+_Static_assert(SD_POOL_SLOTS>0 && SD_POOL_SLOTS<=32, "SD_POOL_SLOTS must be 1..32");
+_Static_assert((SD_POOL_ALIGN&(SD_POOL_ALIGN-1))==0 && (SD_BLOCK_SIZE%SD_POOL_ALIGN)==0, "SD_POOL_ALIGN must be a power of 2 dividing SD_BLOCK_SIZE");
+
+/**
+ * @brief sector buffers, every slot starts and ends on a cache line so cache maintenance of one slot never touches another.
+ */
+static uint8_t pool[SD_POOL_SLOTS][SD_BLOCK_SIZE] __attribute__((aligned(SD_POOL_ALIGN))) SD_POOL_SECTION;
+
+/**
+ * @brief free mask (bit set for free slot), owner of every slot and usage counters, all updated with atomic operations (LDREX/STREX on Cortex-M3 and above).
+ */
+static uint32_t pool_free=(SD_POOL_SLOTS==32)?0xFFFFFFFFU:((1U<<SD_POOL_SLOTS)-1U);
+static uint8_t pool_owner[SD_POOL_SLOTS];
+static uint8_t pool_in_use;
+static uint8_t pool_high_water;
+
+/**
+ * @brief maps a buffer pointer to its slot index.
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @retval int8_t returns the slot index, -1 if buffer is not the start of a slot.
+ */
+static int8_t SD_BufSlot(uint8_t* buf){
+	uintptr_t off=(uintptr_t)buf-(uintptr_t)pool;
+	if((uintptr_t)buf<(uintptr_t)pool || off>=sizeof(pool) || (off%SD_BLOCK_SIZE)!=0){
+		return -1;
+	}
+	return (int8_t)(off/SD_BLOCK_SIZE);
+}
+
+/**
+ * @brief Takes a free sector buffer from the pool, lock-free and O(1).
+ * @param uint8_t owner passes the owner (SD_BUF_xx other than SD_BUF_FREE) taking the buffer.
+ * @retval uint8_t* returns the pointer to SD_BLOCK_SIZE bytes aligned to SD_POOL_ALIGN, NULL if pool is exhausted.
+ */
+uint8_t* SD_BufGet(uint8_t owner){
+	uint32_t mask=__atomic_load_n(&pool_free,__ATOMIC_ACQUIRE);
+	uint8_t slot;
+
+	if(owner==SD_BUF_FREE){
+		return NULL;
+	}
+
+	// claiming the lowest free slot, retried only if another context changed the mask in between.
+	do{
+		if(mask==0){
+			return NULL;
+		}
+		slot=(uint8_t)__builtin_ctz(mask);
+	}while(!__atomic_compare_exchange_n(&pool_free,&mask,mask&~(1U<<slot),0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE));
+
+	__atomic_store_n(&pool_owner[slot],owner,__ATOMIC_RELEASE);
+
+	uint8_t used=__atomic_add_fetch(&pool_in_use,1,__ATOMIC_RELAXED);
+	uint8_t high=__atomic_load_n(&pool_high_water,__ATOMIC_RELAXED);
+	while(used>high && !__atomic_compare_exchange_n(&pool_high_water,&high,used,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+
+	return pool[slot];
+}
+
+/**
+ * @brief Returns a sector buffer to the pool, lock-free and O(1).
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @param uint8_t owner passes the current owner of the buffer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_OWNER.
+ */
+uint8_t SD_BufPut(uint8_t* buf, uint8_t owner){
+	int8_t slot=SD_BufSlot(buf);
+	uint8_t expected=owner;
+
+	if(slot<0 || owner==SD_BUF_FREE){
+		return SD_ERR_OWNER;
+	}
+	// releasing ownership first, slot becomes visible as free only after that.
+	if(!__atomic_compare_exchange_n(&pool_owner[slot],&expected,SD_BUF_FREE,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)){
+		return SD_ERR_OWNER;
+	}
+	__atomic_sub_fetch(&pool_in_use,1,__ATOMIC_RELAXED);
+	__atomic_or_fetch(&pool_free,1U<<slot,__ATOMIC_RELEASE);
+	return SD_OK;
+}
+
+/**
+ * @brief Hands the ownership of a sector buffer to another layer without copying its contents.
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @param uint8_t from passes the current owner of the buffer.
+ * @param uint8_t to passes the new owner (SD_BUF_xx other than SD_BUF_FREE) of the buffer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_OWNER.
+ */
+uint8_t SD_BufHandOff(uint8_t* buf, uint8_t from, uint8_t to){
+	int8_t slot=SD_BufSlot(buf);
+
+	if(slot<0 || from==SD_BUF_FREE || to==SD_BUF_FREE){
+		return SD_ERR_OWNER;
+	}
+	// release/acquire ordering publishes the buffer contents written by the previous owner.
+	if(!__atomic_compare_exchange_n(&pool_owner[slot],&from,to,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)){
+		return SD_ERR_OWNER;
+	}
+	return SD_OK;
+}
+
+/**
+ * @brief Tells the current owner of a sector buffer.
+ * @param uint8_t* buf passes the pointer to the buffer.
+ * @retval uint8_t returns the owner SD_BUF_xx, SD_BUF_FREE for buffers not from the pool.
+ */
+uint8_t SD_BufOwner(uint8_t* buf){
+	int8_t slot=SD_BufSlot(buf);
+	if(slot<0){
+		return SD_BUF_FREE;
+	}
+	return __atomic_load_n(&pool_owner[slot],__ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Tells the number of buffers currently taken from the pool.
+ * @param void
+ * @retval uint8_t returns the number of buffers in use.
+ */
+uint8_t SD_BufInUse(void){
+	return __atomic_load_n(&pool_in_use,__ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Tells the largest number of buffers ever in use at the same time, used to size SD_POOL_SLOTS tightly.
+ * @param void
+ * @retval uint8_t returns the high-water mark.
+ */
+uint8_t SD_BufHighWater(void){
+	return __atomic_load_n(&pool_high_water,__ATOMIC_RELAXED);
+}
@@ -0,0 +1,234 @@
+
+#include "SD_LZ.h"
+
+
+/**
+ * @brief reads 4 bytes from an unaligned address.
+ * @param const uint8_t* p passes the address to be read.
+ * @retval uint32_t returns the 4 bytes.
+ */
+static uint32_t SD_LZ_Read32(const uint8_t* p){
+	uint32_t val;
+	memcpy(&val,p,sizeof(val));
+	return val;
+}
+
+/**
+ * @brief multiplicative hash of 4 bytes of data.
+ * @param uint32_t val passes the 4 bytes to be hashed.
+ * @retval uint16_t returns the index into the hash table.
+ */
+static uint16_t SD_LZ_Hash(uint32_t val){
+	return (uint16_t)((val*2654435761U)>>(32-SD_LZ_HASH_BITS));
+}
+
+/**
+ * @brief calculates the number of extension bytes required by a literal or match length field.
+ * @param uint16_t len passes the length to be encoded.
+ * @retval uint16_t returns the number of extension bytes.
+ */
+static uint16_t SD_LZ_ExtLen(uint16_t len){
+	return (len<SD_LZ_RUN_MASK)?0:(uint16_t)((len-SD_LZ_RUN_MASK)/255+1);
+}
+
+/**
+ * @brief calculates the encoded size of a sequence.
+ * @param uint16_t lit_len passes the number of literals.
+ * @param uint16_t match_len passes the length of the match, 0 for the last (literals only) sequence.
+ * @retval uint16_t returns the size of the sequence in bytes.
+ */
+static uint16_t SD_LZ_SeqLen(uint16_t lit_len, uint16_t match_len){
+	uint16_t len=1+SD_LZ_ExtLen(lit_len)+lit_len;
+	if(match_len!=0){
+		len+=2+SD_LZ_ExtLen(match_len-SD_LZ_MIN_MATCH);
+	}
+	return len;
+}
+
+/**
+ * @brief writes the extension bytes of a length field which is not less than SD_LZ_RUN_MASK.
+ * @param uint8_t* op passes the output pointer.
+ * @param uint16_t len passes the length to be encoded.
+ * @retval uint8_t* returns the output pointer after the extension bytes.
+ */
+static uint8_t* SD_LZ_PutLen(uint8_t* op, uint16_t len){
+	len-=SD_LZ_RUN_MASK;
+	while(len>=255){
+		*op++=255;
+		len-=255;
+	}
+	*op++=(uint8_t)len;
+	return op;
+}
+
+/**
+ * @brief writes one sequence i.e. token, literals, offset and match length.
+ * @param uint8_t* op passes the output pointer.
+ * @param const uint8_t* lit passes the pointer to the literals.
+ * @param uint16_t lit_len passes the number of literals.
+ * @param uint16_t offset passes the backward distance of the match.
+ * @param uint16_t match_len passes the length of the match, 0 for the last (literals only) sequence.
+ * @retval uint8_t* returns the output pointer after the sequence.
+ */
+static uint8_t* SD_LZ_PutSeq(uint8_t* op, const uint8_t* lit, uint16_t lit_len, uint16_t offset, uint16_t match_len){
+	uint8_t* token=op++;
+	uint8_t tk=(uint8_t)(((lit_len<SD_LZ_RUN_MASK)?lit_len:SD_LZ_RUN_MASK)<<4);
+
+	if(lit_len>=SD_LZ_RUN_MASK){
+		op=SD_LZ_PutLen(op,lit_len);
+	}
+	memcpy(op,lit,lit_len);
+	op+=lit_len;
+
+	if(match_len!=0){
+		uint16_t ml=match_len-SD_LZ_MIN_MATCH;
+		*op++=(uint8_t)(offset);
+		*op++=(uint8_t)(offset>>8);
+		tk|=(uint8_t)((ml<SD_LZ_RUN_MASK)?ml:SD_LZ_RUN_MASK);
+		if(ml>=SD_LZ_RUN_MASK){
+			op=SD_LZ_PutLen(op,ml);
+		}
+	}
+	*token=tk;
+	return op;
+}
+
+/**
+ * @brief Compresses as much of the source as fits in the destination, sequences are in LZ4 block format (token, literals, 2 byte offset, extension bytes).
+ * @param sd_lz_hash* ht passes the pointer to the work memory, cleared by this routine.
+ * @param const uint8_t* src passes the pointer to the data to be compressed.
+ * @param uint16_t src_len passes the size of the data in bytes.
+ * @param uint8_t* dst passes the pointer to the memory region where the compressed data has to be stored.
+ * @param uint16_t dst_cap passes the size of the destination in bytes.
+ * @param uint16_t* consumed returns the number of source bytes encoded into the destination.
+ * @retval uint16_t returns the size of the compressed data in bytes.
+ */
+uint16_t SD_LZ_Compress(sd_lz_hash* ht, const uint8_t* src, uint16_t src_len, uint8_t* dst, uint16_t dst_cap, uint16_t* consumed){
+	uint16_t ip=0;
+	uint16_t anchor=0;
+	uint16_t out=0;
+
+	memset(ht,0,sizeof(sd_lz_hash));
+
+	while(src_len>=SD_LZ_MIN_MATCH && ip<=src_len-SD_LZ_MIN_MATCH){
+		uint16_t lit=ip-anchor;
+
+		// pending literals plus the smallest match must still fit, else stop searching.
+		if(out+SD_LZ_SeqLen(lit,SD_LZ_MIN_MATCH)>dst_cap){
+			break;
+		}
+
+		uint32_t seq=SD_LZ_Read32(&src[ip]);
+		uint16_t h=SD_LZ_Hash(seq);
+		uint16_t ref=ht->slot[h];
+		ht->slot[h]=ip+1;
+
+		// offset field is 2 bytes, farther matches can not be encoded.
+		if(ref==0 || (uint32_t)(ip-(ref-1))>SD_LZ_MAX_OFFSET || SD_LZ_Read32(&src[ref-1])!=seq){
+			ip++;
+			continue;
+		}
+
+		uint16_t match=ref-1;
+		uint16_t ml=SD_LZ_MIN_MATCH;
+		while(ip+ml<src_len && src[match+ml]==src[ip+ml]){
+			ml++;
+		}
+
+		if(out+SD_LZ_SeqLen(lit,ml)>dst_cap){
+			break;
+		}
+		out=(uint16_t)(SD_LZ_PutSeq(&dst[out],&src[anchor],lit,ip-match,ml)-dst);
+		ip+=ml;
+		anchor=ip;
+	}
+
+	// last sequence holds the remaining literals, as many as fit.
+	uint16_t avail=dst_cap-out;
+	uint16_t lit=src_len-anchor;
+	if(avail==0){
+		lit=0;
+	}else if(lit>avail-1){
+		lit=avail-1;
+	}
+	while(lit>0 && SD_LZ_SeqLen(lit,0)>avail){
+		lit--;
+	}
+	if(lit>0){
+		out=(uint16_t)(SD_LZ_PutSeq(&dst[out],&src[anchor],lit,0,0)-dst);
+	}
+
+	*consumed=anchor+lit;
+	return out;
+}
+
+/**
+ * @brief Decompresses data produced by SD_LZ_Compress, every offset and length is bound checked.
+ * @param const uint8_t* src passes the pointer to the compressed data.
+ * @param uint16_t src_len passes the size of the compressed data in bytes.
+ * @param uint8_t* dst passes the pointer to the memory region where the decompressed data has to be stored.
+ * @param uint16_t dst_cap passes the size of the destination in bytes.
+ * @retval uint16_t returns the size of the decompressed data in bytes, 0 for corrupt input.
+ */
+uint16_t SD_LZ_Decompress(const uint8_t* src, uint16_t src_len, uint8_t* dst, uint16_t dst_cap){
+	uint16_t ip=0;
+	uint16_t op=0;
+
+	while(ip<src_len){
+		uint8_t tk=src[ip++];
+		uint32_t lit=tk>>4;
+		uint8_t b;
+
+		if(lit==SD_LZ_RUN_MASK){
+			do{
+				if(ip>=src_len){
+					return 0;
+				}
+				b=src[ip++];
+				lit+=b;
+			}while(b==255);
+		}
+		if(lit>(uint32_t)(src_len-ip) || lit>(uint32_t)(dst_cap-op)){
+			return 0;
+		}
+		memcpy(&dst[op],&src[ip],lit);
+		op+=lit;
+		ip+=lit;
+
+		// last sequence carries literals only.
+		if(ip>=src_len){
+			break;
+		}
+
+		if(src_len-ip<2){
+			return 0;
+		}
+		uint16_t offset=(uint16_t)(src[ip]|(src[ip+1]<<8));
+		ip+=2;
+		if(offset==0 || offset>op){
+			return 0;
+		}
+
+		uint32_t ml=tk&SD_LZ_RUN_MASK;
+		if(ml==SD_LZ_RUN_MASK){
+			do{
+				if(ip>=src_len){
+					return 0;
+				}
+				b=src[ip++];
+				ml+=b;
+			}while(b==255);
+		}
+		ml+=SD_LZ_MIN_MATCH;
+		if(ml>(uint32_t)(dst_cap-op)){
+			return 0;
+		}
+
+		// byte-wise copy, match may overlap the bytes being produced.
+		for(uint16_t m=op-offset;ml>0;ml--){
+			dst[op++]=dst[m++];
+		}
+	}
+
+	return op;
+}
@@ -0,0 +1,268 @@
+
+#include "SD_LZStream.h"
+
+
+/**
+ * @brief writes a 32 bit value in little endian order.
+ * @param uint8_t* p passes the destination address.
+ * @param uint32_t val passes the value.
+ * @retval void
+ */
+static void SD_LZ_Put32(uint8_t* p, uint32_t val){
+	p[0]=(uint8_t)(val);
+	p[1]=(uint8_t)(val>>8);
+	p[2]=(uint8_t)(val>>16);
+	p[3]=(uint8_t)(val>>24);
+}
+
+/**
+ * @brief reads a 32 bit value stored in little endian order.
+ * @param const uint8_t* p passes the source address.
+ * @retval uint32_t returns the value.
+ */
+static uint32_t SD_LZ_Get32(const uint8_t* p){
+	return (uint32_t)p[0]|((uint32_t)p[1]<<8)|((uint32_t)p[2]<<16)|((uint32_t)p[3]<<24);
+}
+
+/**
+ * @brief writes the frames waiting in the batch with a single multiple block write.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the block write, batch is kept on failure so that the same sectors are retried.
+ */
+static uint8_t SD_LZ_WriteBatch(sd_lz_writer* w){
+	uint32_t first=w->frame-w->batch_fill;
+	uint32_t start=SD_LZ_CYCLES();
+
+	uint8_t status=SD_WriteBlocks(w->base_sector+first,w->batch,w->batch_fill);
+
+	w->stats.write_cycles+=(uint32_t)(SD_LZ_CYCLES()-start);
+	if(status!=SD_OK){
+		return status;
+	}
+	w->stats.card_bytes+=(uint32_t)w->batch_fill*SD_BLOCK_SIZE;
+	w->batch_fill=0;
+	return SD_OK;
+}
+
+/**
+ * @brief compresses the head of the staged data into the next frame of the batch, batch is written once full.  A batch left full by a failed write is retried first, staged data stays untouched if that fails again.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the block write.
+ */
+static uint8_t SD_LZ_EmitFrame(sd_lz_writer* w){
+	if(w->batch_fill==SD_LZ_BATCH_FRAMES){
+		uint8_t status=SD_LZ_WriteBatch(w);
+		if(status!=SD_OK){
+			return status;
+		}
+	}
+
+	uint8_t* f=&w->batch[(uint32_t)w->batch_fill*SD_BLOCK_SIZE];
+	uint8_t flags=0x00;
+	uint16_t consumed;
+	uint32_t start=SD_LZ_CYCLES();
+
+	uint16_t plen=SD_LZ_Compress(&w->ht,w->raw,w->raw_fill,&f[SD_LZ_FRAME_HDR_SIZE],SD_LZ_FRAME_PAYLOAD,&consumed);
+
+	// storing raw data carries more of the stream when data did not compress.
+	uint16_t stored=(w->raw_fill<SD_LZ_FRAME_PAYLOAD)?w->raw_fill:SD_LZ_FRAME_PAYLOAD;
+	if(consumed<stored){
+		memcpy(&f[SD_LZ_FRAME_HDR_SIZE],w->raw,stored);
+		plen=stored;
+		consumed=stored;
+		flags|=SD_LZ_FLAG_STORED;
+	}
+	memset(&f[SD_LZ_FRAME_HDR_SIZE+plen],0x00,SD_LZ_FRAME_PAYLOAD-plen);
+
+	f[0]=SD_LZ_FRAME_MAGIC;
+	f[1]=flags;
+	f[2]=(uint8_t)(consumed);
+	f[3]=(uint8_t)(consumed>>8);
+	f[4]=(uint8_t)(plen);
+	f[5]=(uint8_t)(plen>>8);
+	SD_LZ_Put32(&f[6],w->stream_id);
+	SD_LZ_Put32(&f[10],w->frame);
+
+	w->raw_fill-=consumed;
+	memmove(w->raw,&w->raw[consumed],w->raw_fill);
+	w->stats.compress_cycles+=(uint32_t)(SD_LZ_CYCLES()-start);
+
+	w->frame++;
+	w->batch_fill++;
+	w->stats.frames++;
+
+	if(w->batch_fill==SD_LZ_BATCH_FRAMES){
+		return SD_LZ_WriteBatch(w);
+	}
+	return SD_OK;
+}
+
+/**
+ * @brief Initializes a compressed stream writer and enables the cycle counter of the statistics.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @param uint32_t base_sector passes the sector where frame 0 has to be written.
+ * @param uint32_t stream_id passes the ID of the stream e.g. a boot counter or RTC time, must differ from the ID of the stream previously written at base_sector.
+ * @retval void
+ */
+void SD_LZ_WriterInit(sd_lz_writer* w, uint32_t base_sector, uint32_t stream_id){
+	w->base_sector=base_sector;
+	w->stream_id=stream_id;
+	w->frame=0;
+	w->raw_fill=0;
+	w->batch_fill=0;
+	memset(&w->stats,0x00,sizeof(sd_lz_stats));
+	SD_LZ_CYCLES_INIT();
+}
+
+/**
+ * @brief Appends data to the compressed stream, full batches of frames are written to the card.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @param const uint8_t* data passes the pointer to the data to be appended.
+ * @param uint32_t len passes the size of the data in bytes.
+ * @param uint32_t* taken returns the number of bytes accepted into the stream, the rest has to be passed again after an error.
+ * @retval uint8_t returns SD_OK on success (all of len taken) else SD_ERR_xx of the failed block write.
+ */
+uint8_t SD_LZ_Write(sd_lz_writer* w, const uint8_t* data, uint32_t len, uint32_t* taken){
+	*taken=0;
+	while(len>0){
+		// staging is emptied before taking more, a failed emit leaves it full and nothing more is taken.
+		if(w->raw_fill==SD_LZ_RAW_MAX){
+			uint8_t status=SD_LZ_EmitFrame(w);
+			if(status!=SD_OK){
+				return status;
+			}
+		}
+
+		uint32_t n=SD_LZ_RAW_MAX-w->raw_fill;
+		if(n>len){
+			n=len;
+		}
+		memcpy(&w->raw[w->raw_fill],&data[*taken],n);
+		w->raw_fill+=n;
+		w->stats.raw_bytes+=n;
+		*taken+=n;
+		len-=n;
+	}
+	return SD_OK;
+}
+
+/**
+ * @brief Compresses the staged data into frames and writes every pending frame to the card.
+ * @param sd_lz_writer* w passes the pointer to the writer.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the failed block write, pending frames are kept and the call can be repeated.
+ */
+uint8_t SD_LZ_Flush(sd_lz_writer* w){
+	while(w->raw_fill>0){
+		uint8_t status=SD_LZ_EmitFrame(w);
+		if(status!=SD_OK){
+			return status;
+		}
+	}
+	if(w->batch_fill>0){
+		return SD_LZ_WriteBatch(w);
+	}
+	return SD_OK;
+}
+
+
+/**
+ * @brief reads and decompresses a frame.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint32_t frame passes the index of the frame.
+ * @param uint8_t adopt tells to take the stream ID from the frame instead of checking it.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_FRAME for invalid frame else SD_ERR_xx of the failed block read.
+ */
+static uint8_t SD_LZ_LoadFrame(sd_lz_reader* r, uint32_t frame, uint8_t adopt){
+	uint8_t* f=r->sector;
+
+	r->raw_len=0;
+	r->raw_pos=0;
+
+	uint8_t status=SD_ReadBlock(r->base_sector+frame,f);
+	if(status!=SD_OK){
+		return status;
+	}
+
+	uint16_t raw_len=(uint16_t)(f[2]|(f[3]<<8));
+	uint16_t plen=(uint16_t)(f[4]|(f[5]<<8));
+	uint32_t stream_id=SD_LZ_Get32(&f[6]);
+	uint32_t seq=SD_LZ_Get32(&f[10]);
+
+	if(f[0]!=SD_LZ_FRAME_MAGIC || seq!=frame || raw_len==0 || raw_len>SD_LZ_RAW_MAX || plen>SD_LZ_FRAME_PAYLOAD){
+		return SD_ERR_FRAME;
+	}
+	// frames of an older stream (past the end or in a hole left by a failed write) carry another stream ID.
+	if(adopt){
+		r->stream_id=stream_id;
+	}else if(stream_id!=r->stream_id){
+		return SD_ERR_FRAME;
+	}
+
+	if(f[1]&SD_LZ_FLAG_STORED){
+		if(plen!=raw_len){
+			return SD_ERR_FRAME;
+		}
+		memcpy(r->raw,&f[SD_LZ_FRAME_HDR_SIZE],plen);
+	}else if(SD_LZ_Decompress(&f[SD_LZ_FRAME_HDR_SIZE],plen,r->raw,SD_LZ_RAW_MAX)!=raw_len){
+		return SD_ERR_FRAME;
+	}
+
+	r->raw_len=raw_len;
+	r->frame=frame+1;
+	return SD_OK;
+}
+
+/**
+ * @brief Initializes a compressed stream reader positioned at the start of frame 0, stream ID is taken from frame 0.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint32_t base_sector passes the sector of frame 0.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_FRAME if there is no stream else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_ReaderInit(sd_lz_reader* r, uint32_t base_sector){
+	r->base_sector=base_sector;
+	r->frame=0;
+	return SD_LZ_LoadFrame(r,0,1);
+}
+
+/**
+ * @brief Positions the reader at the start of a frame by reading and decompressing it.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint32_t frame passes the index of the frame.
+ * @retval uint8_t returns SD_OK on success, SD_ERR_FRAME past the end of stream or at a frame lost by a failed write else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_Seek(sd_lz_reader* r, uint32_t frame){
+	return SD_LZ_LoadFrame(r,frame,0);
+}
+
+/**
+ * @brief Reads decompressed data sequentially, crossing frame boundaries as required.
+ * @param sd_lz_reader* r passes the pointer to the reader.
+ * @param uint8_t* buffer passes the pointer to the memory region where the data has to be stored.
+ * @param uint32_t len passes the number of bytes requested.
+ * @param uint32_t* got returns the number of bytes stored, less than requested at the end of stream.
+ * @retval uint8_t returns SD_OK on success or end of stream else SD_ERR_xx of the failed block read.
+ */
+uint8_t SD_LZ_Read(sd_lz_reader* r, uint8_t* buffer, uint32_t len, uint32_t* got){
+	*got=0;
+	while(len>0){
+		if(r->raw_pos==r->raw_len){
+			uint8_t status=SD_LZ_Seek(r,r->frame);
+			if(status==SD_ERR_FRAME){
+				return SD_OK;	// end of stream.
+			}
+			if(status!=SD_OK){
+				return status;
+			}
+		}
+
+		uint32_t n=r->raw_len-r->raw_pos;
+		if(n>len){
+			n=len;
+		}
+		memcpy(&buffer[*got],&r->raw[r->raw_pos],n);
+		r->raw_pos+=n;
+		*got+=n;
+		len-=n;
+	}
+	return SD_OK;
+}
@@ -17,6 +17,36 @@ uint8_t arg_cmds[ARG_SIZE]={0};
  */
 resp response;
 
+/**
+ * @brief declaring the SPI link state, filled by the calibration.
+ */
+sd_link SD_Link;
+
+/**
+ * @brief bytes clocked in after the response by the last command burst, the data phase starts with them.
+ */
+static uint8_t cmd_tail[CMD_FRAME_MAX];
+static uint8_t cmd_tail_len;
+
+/**
+ * @brief SPI prescalers indexed by the link rate, slowest first.
+ */
+static const uint32_t link_prescaler[SD_LINK_RATES]={
+	SPI_BAUDRATEPRESCALER_256,
+	SPI_BAUDRATEPRESCALER_128,
+	SPI_BAUDRATEPRESCALER_64,
+	SPI_BAUDRATEPRESCALER_32,
+	SPI_BAUDRATEPRESCALER_16,
+	SPI_BAUDRATEPRESCALER_8,
+	SPI_BAUDRATEPRESCALER_4,
+	SPI_BAUDRATEPRESCALER_2,
+};
+
+/**
+ * @brief SPI clock dividers of the above prescalers.
+ */
+static const uint16_t link_divider[SD_LINK_RATES]={256,128,64,32,16,8,4,2};
+
 /**
  * @brief getCRC calculates the CRC7 of a given sequence.
  * @param uint8_t* addr passes the address of the data whose CRC7 has to be calculated.
@@ -81,127 +111,241 @@ void SD_Deselect(void){
 }
 
 /**
- * @brief Sends a specific command
+ * @brief command descriptor table indexed by CMD_INDEX(command), ACMDs share the slot of the CMD with same index (responses are identical for every such pair in SPI mode).
+ */
+static const cmd_desc cmd_table[CMD_TABLE_SIZE]={
+	[CMD_INDEX(CMD0)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_INIT},
+	[CMD_INDEX(CMD1)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_INIT},
+	[CMD_INDEX(CMD6)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD8)]	={CMD_TYPE_R7,  5, CMD_FLAG_NONE,  CMD_POLL_INIT},
+	[CMD_INDEX(CMD9)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD10)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD12)]	={CMD_TYPE_R1B, 1, CMD_FLAG_BUSY|CMD_FLAG_STUFF, CMD_POLL_NCR},
+	[CMD_INDEX(CMD13)]	={CMD_TYPE_R2,  2, CMD_FLAG_DATA,  CMD_POLL_NCR},	// ACMD13 as well, data block belongs to ACMD13 only.
+	[CMD_INDEX(CMD16)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD17)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD18)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(ACMD22)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(ACMD23)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD24)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD25)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD27)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD28)]	={CMD_TYPE_R1B, 1, CMD_FLAG_BUSY,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD29)]	={CMD_TYPE_R1B, 1, CMD_FLAG_BUSY,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD30)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD32)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD33)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD38)]	={CMD_TYPE_R1B, 1, CMD_FLAG_BUSY,  CMD_POLL_NCR},
+	[CMD_INDEX(ACMD41)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_INIT},
+	[CMD_INDEX(CMD42)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},	// ACMD42 as well.
+	[CMD_INDEX(ACMD51)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD55)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_INIT},
+	[CMD_INDEX(CMD56)]	={CMD_TYPE_R1,  1, CMD_FLAG_DATA,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD58)]	={CMD_TYPE_R3,  5, CMD_FLAG_NONE,  CMD_POLL_NCR},
+	[CMD_INDEX(CMD59)]	={CMD_TYPE_R1,  1, CMD_FLAG_NONE,  CMD_POLL_NCR},
+};
+
+/**
+ * @brief Returns the descriptor of a command from the command descriptor table.
+ * @param uint8_t command passes the command value whose descriptor is required.
+ * @retval const cmd_desc* returns the pointer to the descriptor, NULL if command is not supported in SPI mode.
+ */
+const cmd_desc* SD_GetCmdDesc(uint8_t command){
+	const cmd_desc* desc=&cmd_table[CMD_INDEX(command)];
+	return (desc->type==0x00)?NULL:desc;
+}
+
+/**
+ * @brief maps the response type to its buffer in the response box.
+ * @param resp* respbox passes the pointer to the response box structure.
+ * @param uint8_t cmd_type passes the response type (CMD_TYPE_xx).
+ * @retval uint8_t* returns the pointer to the buffer, NULL for unknown response type.
+ */
+static uint8_t* SD_RespSlot(resp* respbox, uint8_t cmd_type){
+	switch(cmd_type){
+		case CMD_TYPE_R1 :	return respbox->r1;
+		case CMD_TYPE_R1B :	return respbox->r1b;
+		case CMD_TYPE_R2 :	return respbox->r2;
+		case CMD_TYPE_R3 :	return respbox->r3;
+		case CMD_TYPE_R7 :	return respbox->r7;
+		default :			return NULL;
+	}
+}
+
+/**
+ * @brief Sends a specific command and captures its response in a single burst transaction, CS is asserted and left asserted for the data phase, caller de-selects the chip.
+ * @param cmd_format* cmd passes the pointer to the command format structure into which the command is casted.
  * @param uint8_t command passes the command value corresponding to the command to be sent.
  * @param uint8_t* arg passes the pointer to the 4 byte argument array.
- * @retval uint8_t* returns the pointer to appropriate buffer in 'resp' structure.
+ * @param resp* respbox passes the pointer to the response box structure.
+ * @retval uint8_t* returns the pointer to appropriate buffer in 'resp' structure, NULL on failure or no response.
  */
-uint8_t* SendSD_Command(cmd_format* cmd, uint8_t command, uint8_t cmd_type, uint8_t* arg, resp* respbox){
-	
-	vcom_printf("CURRENT_CMD_EXEC : CMD%d\r\n",command&(0x3F));
+uint8_t* SendSD_Command(cmd_format* cmd, uint8_t command, uint8_t* arg, resp* respbox){
 
+	const cmd_desc* desc=SD_GetCmdDesc(command);
+	cmd_tail_len=0;
+	if(desc==NULL){
+		vcom_printf("CMD%d not supported in SPI mode.\r\n",CMD_INDEX(command));
+		return NULL;
+	}
 
 	// Preparing the command to be sent.
 	cmd->CMD=command;
-	for(uint8_t i=0;i<4;i++){
+	for(uint8_t i=0;i<ARG_SIZE;i++){
 		(cmd->ARG)[i]=arg[i];
 	}
-	
+
 	switch(command){
 		case CMD0 :
 			cmd->CRC7=CRC_CMD0;
-			vcom_printf("Setting CMD0 CRC...\r\n");
 			break;
 
 		case CMD8 :
-			vcom_printf("Setting CMD8 CRC...\r\n");
 			cmd->CRC7=CRC_CMD8_DEFAULT;
 			break;
 
 		case CMD55 :
-			vcom_printf("Setting CMD55 CRC...\r\n");
 			cmd->CRC7=CRC_CMD55_DEFAULT;
 			break;
 
 		default :
 			cmd->CRC7=((getCRC7((uint8_t*)cmd,ARG_SIZE+1)<<1)|(SEND_CMD_END_BIT));
-			vcom_printf("CRC7 : %d %#x\r\n",cmd->CRC7,cmd->CRC7);
 	}
 
-	vcom_printf("COMMAND DUMP : \r\n");
-	for(uint8_t i=0;i<6;i++){
-		vcom_printf("CMD_DMP[%d] : %d %#x\r\n",i,((uint8_t*)cmd)[i],((uint8_t*)cmd)[i]);
-	}
+	// command frame followed by the poll window, clocked out in one transaction.
+	uint8_t tx[CMD_FRAME_MAX];
+	uint8_t rx[CMD_FRAME_MAX];
+	uint16_t skip=sizeof(cmd_format)+((desc->flags&CMD_FLAG_STUFF)?1:0);
+	uint16_t frame=skip+desc->poll+desc->len;
 
-	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
-	SD_Select();
-	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
-	// sending the command
-	vcom_printf("Sending command...\r\n");
-	uint8_t stat=HAL_SPI_Transmit(HSPI_STRUCT_PTR, (uint8_t*)cmd, sizeof(*cmd), HAL_MAX_DELAY);
-	vcom_printf("stat : %d %#x\r\n",stat,stat);
-	if(stat!=HAL_OK){
+	memcpy(tx,cmd,sizeof(cmd_format));
+	memset(&tx[sizeof(cmd_format)],DUMMY_BYTE,frame-sizeof(cmd_format));
+	memset(respbox,DUMMY_BYTE,sizeof(resp));
 
+	SD_Select();
+	if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, tx, rx, frame, HAL_MAX_DELAY)!=HAL_OK){
+		vcom_printf("CMD%d transaction failed.\r\n",CMD_INDEX(command));
 		return NULL;
 	}
-	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
-	SD_Deselect();
-	SET_RESP(DUMMY_BYTE);
-	// waiting for response...
-	if(cmd_type==CMD_TYPE_R1){
-		// SD card, in response of void receive routines returns dummy bytes 0xFF and thus can be easily polled for non-dummy bytes.
-			for(uint8_t count=0;count<20;count++){
-				HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r1b, respbox->r1, sizeof(uint8_t), HAL_MAX_DELAY);
-				if(*(respbox->r1) != DUMMY_BYTE){
-					return respbox->r1;
-				}
-			}
-			vcom_printf("CMD_TYPE_R1\r\n");
-	   }else if(cmd_type==CMD_TYPE_R1B ){
-		   for(uint8_t count=0;count<8;count++){
-
-			   HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r2, respbox->r1b, sizeof(uint8_t), HAL_MAX_DELAY);
-			   if(*(respbox->r1b) != DUMMY_BYTE){
-
-				   return respbox->r1b;
-			   }
-
-		   }
-		   vcom_printf("CMD_TYPE_R1B\r\n");
-	   }else if(cmd_type==CMD_TYPE_R2){	// checking for command with r2 response
-		   for(uint8_t count=0;count<8;count++){
 
+	// SD card keeps MISO high (0xFF) until the response, first non-dummy byte is start of the response.
+	uint16_t pos=skip;
+	while(pos<frame && rx[pos]==DUMMY_BYTE){
+		pos++;
+	}
+	if(pos>=frame){
+		vcom_printf("CMD%d no response.\r\n",CMD_INDEX(command));
+		return NULL;
+	}
 
-			   HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r3, respbox->r2, sizeof(uint8_t), HAL_MAX_DELAY);
-			   if((respbox->r2)[0] != DUMMY_BYTE){
-				   HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r3, &((respbox->r2)[1]), sizeof(uint8_t), HAL_MAX_DELAY);
+	uint8_t* out=SD_RespSlot(respbox,desc->type);
+	uint16_t got=frame-pos;
+	if(got>desc->len){
+		got=desc->len;
+	}
+	memcpy(out,&rx[pos],got);
 
-				   return respbox->r2;
-			   }
+	// response started late in the window, fetching the remaining bytes.
+	if(got<desc->len){
+		if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, &tx[sizeof(cmd_format)], &out[got], desc->len-got, HAL_MAX_DELAY)!=HAL_OK){
+			return NULL;
+		}
+	}else if(desc->flags&CMD_FLAG_DATA){
+		// start token may follow the response by a single byte (NAC min is 1), keeping the rest of the window for the data phase.
+		cmd_tail_len=(uint8_t)(frame-(pos+desc->len));
+		memcpy(cmd_tail,&rx[pos+desc->len],cmd_tail_len);
+	}
 
-		   }
-		   vcom_printf("CMD_TYPE_R2\r\n");
-	   }else if(cmd_type==CMD_TYPE_R3){	// checking for command with r3 response
-		   for(uint8_t count=0;count<8;count++){
+	// busy is released once MISO returns high, the trailing byte of the window may already tell that.
+	if(desc->flags&CMD_FLAG_BUSY){
+		if(pos+desc->len>=frame || rx[frame-1]!=DUMMY_BYTE){
+			if(SD_WaitReady(SD_BUSY_TIMEOUT_MS)!=0x00){
+				vcom_printf("CMD%d busy timeout.\r\n",CMD_INDEX(command));
+				return NULL;
+			}
+		}
+	}
 
+	return out;
+}
 
-			   HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r7, respbox->r3, sizeof(uint8_t), HAL_MAX_DELAY);
-			   if((respbox->r3)[0] != DUMMY_BYTE){
-				   HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r7, &((respbox->r3)[1]), sizeof(respbox->r3)/sizeof(uint8_t)-1, HAL_MAX_DELAY);
+/**
+ * @brief Waits until the card releases the busy signal (MISO high).  Chip must always be selected before using this routine.
+ * @param uint32_t timeout_ms passes the maximum time in milliseconds to wait.
+ * @retval uint8_t returns 0x00 if card is ready, 0x01 on timeout or bus failure.
+ */
+uint8_t SD_WaitReady(uint32_t timeout_ms){
+	uint8_t tx[SD_BUSY_CHUNK];
+	uint8_t rx[SD_BUSY_CHUNK];
+	memset(tx,DUMMY_BYTE,SD_BUSY_CHUNK);
 
-				   return respbox->r3;
-			   }
+	uint32_t start=HAL_GetTick();
+	do{
+		if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, tx, rx, SD_BUSY_CHUNK, HAL_MAX_DELAY)!=HAL_OK){
+			return 0x01;
+		}
+		if(rx[SD_BUSY_CHUNK-1]==DUMMY_BYTE){
+			return 0x00;
+		}
+	}while((HAL_GetTick()-start)<timeout_ms);
 
-		   }
-		   vcom_printf("CMD_TYPE_R3\r\n");
-	   }else if(cmd_type==CMD_TYPE_R7){	// checking for command with r7 response
+	return 0x01;
+}
 
-		    vcom_printf("Setting response for CMD8...\r\n");
+/**
+ * @brief Receives the data block of the last command i.e. waits for the start token, then receives the data and its CRC16.  Bytes already clocked in by the command burst are consumed first.  Chip must always be selected before using this routine.
+ * @param uint8_t* buffer passes the pointer to the memory region where the data has to be stored.
+ * @param uint16_t byte_count passes the size of the data block in bytes.
+ * @param uint16_t* crc16 returns the CRC16 sent by the card.
+ * @param uint32_t timeout_ms passes the maximum time in milliseconds to wait for the start token.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_TOKEN.
+ */
+uint8_t SD_ReceiveData(uint8_t* buffer, uint16_t byte_count, uint16_t* crc16, uint32_t timeout_ms){
+	uint8_t token=DUMMY_BYTE;
+	uint8_t crc[2];
+	uint16_t got=0;
+	uint8_t pos=0;
+
+	while(pos<cmd_tail_len && cmd_tail[pos]==DUMMY_BYTE){
+		pos++;
+	}
+	if(pos<cmd_tail_len){
+		token=cmd_tail[pos++];
+		for(;pos<cmd_tail_len && got<byte_count+2;pos++,got++){
+			if(got<byte_count){
+				buffer[got]=cmd_tail[pos];
+			}else{
+				crc[got-byte_count]=cmd_tail[pos];
+			}
+		}
+	}
+	cmd_tail_len=0;
 
-		    for(uint8_t count=0;count<8;count++){
+	// anything other than 0xFF/0xFE is a data error token.
+	uint32_t start=HAL_GetTick();
+	while(token==DUMMY_BYTE && (HAL_GetTick()-start)<timeout_ms){
+		if(SD_ReceiveBytes(&token,1)!=1){
+			return SD_ERR_TOKEN;
+		}
+	}
+	if(token!=TOKEN_START_BLOCK){
+		return SD_ERR_TOKEN;
+	}
 
+	if(got<byte_count){
+		if(SD_ReceiveBytes(&buffer[got],byte_count-got)!=byte_count-got){
+			return SD_ERR_TOKEN;
+		}
+		got=byte_count;
+	}
+	if(got<byte_count+2){
+		if(SD_ReceiveBytes(&crc[got-byte_count],byte_count+2-got)!=byte_count+2-got){
+			return SD_ERR_TOKEN;
+		}
+	}
 
-		    	HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r3, respbox->r7, sizeof(uint8_t), HAL_MAX_DELAY);
-		    	if((respbox->r7)[0] != DUMMY_BYTE){
-		    		vcom_printf("count value : %d\r\n",count);
-		    		HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, respbox->r3, &((respbox->r7)[1]), sizeof(respbox->r7)/sizeof(uint8_t)-1, HAL_MAX_DELAY);
-		    		return respbox->r7;
-		    	}
-		    }
-		    vcom_printf("CMD_TYPE_R7\r\n");
-	   }
-	   vcom_printf("LAST NULL RETURN SD_init()\r\n");
-	   return NULL;
+	*crc16=(uint16_t)((crc[0]<<8)|crc[1]);
+	return SD_OK;
 }
 
 /**
@@ -224,11 +368,10 @@ uint16_t SD_TransmitBytes(uint8_t* bytestream, uint16_t byte_count){
  * @retval uint16_t returns the size of received data in bytes
  */
 uint16_t SD_ReceiveBytes(uint8_t* buffer, uint16_t byte_count){
-	uint8_t db=DUMMY_BYTE;
-	for(uint16_t size=0;size<byte_count;size++){
-		if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, &db, &(buffer[size]), sizeof(uint8_t), HAL_MAX_DELAY)!=HAL_OK){
-			return size;
-		}
+	// MOSI must stay high while receiving, buffer is filled with dummy bytes and clocked out in place.
+	memset(buffer,DUMMY_BYTE,byte_count);
+	if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, buffer, buffer, byte_count, HAL_MAX_DELAY)!=HAL_OK){
+		return 0x00;
 	}
 	return byte_count;
 }
@@ -273,7 +416,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 	vcom_printf("Sending CMD0 and capturing response...\r\n");
 
 	for(uint8_t try=0;try<CMD0_MAX_TRIES;try++){
-		if(SendSD_Command(_cmd,CMD0,CMD_TYPE_R1,_arg_cmds,_respbox)==NULL){
+		if(SendSD_Command(_cmd,CMD0,_arg_cmds,_respbox)==NULL){
 			SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 			SD_Deselect();
 			vcom_printf("CMD0 failed.\r\n");
@@ -307,7 +450,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 	SD_Select();
 	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 	
-	if(SendSD_Command(_cmd,CMD8,CMD_TYPE_R7,_arg_cmds,_respbox)==NULL){
+	if(SendSD_Command(_cmd,CMD8,_arg_cmds,_respbox)==NULL){
 		SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 		SD_Deselect();
 		return 0x03;	// CMD8 send failed.
@@ -346,7 +489,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 		SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 
 		SET_ARG_CMDS(~DUMMY_BYTE);
-		if(SendSD_Command(_cmd,CMD55,CMD_TYPE_R1,_arg_cmds,_respbox)==NULL){
+		if(SendSD_Command(_cmd,CMD55,_arg_cmds,_respbox)==NULL){
 			SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 			SD_Deselect();
 			vcom_printf("UNKNOWN FAILURE:((((((\r\n");
@@ -366,7 +509,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 				vcom_printf("ACMD41[%d] : %d %#x\r\n",num,((uint8_t*)_cmd)[num],((uint8_t*)_cmd)[num]);
 			}
 
-			if(SendSD_Command(_cmd,ACMD41,CMD_TYPE_R1,_arg_cmds,_respbox)==NULL){
+			if(SendSD_Command(_cmd,ACMD41,_arg_cmds,_respbox)==NULL){
 				SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 				SD_Deselect();
 				return 0x07;
@@ -397,7 +540,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 		SD_Select();
 		SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 
-		if(SendSD_Command(_cmd,CMD55,CMD_TYPE_R1,_arg_cmds,_respbox)==NULL){
+		if(SendSD_Command(_cmd,CMD55,_arg_cmds,_respbox)==NULL){
 			SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 			SD_Deselect();
 			return 0x06;
@@ -409,7 +552,7 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 			SET_RESP(DUMMY_BYTE);
 			// arg preparation for ACMD41
 			_arg_cmds[0]=0x40;
-			if(SendSD_Command(_cmd,ACMD41,CMD_TYPE_R1,_arg_cmds,_respbox)==NULL){
+			if(SendSD_Command(_cmd,ACMD41,_arg_cmds,_respbox)==NULL){
 				SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
 				SD_Deselect();
 				return 0x07;
@@ -436,3 +579,369 @@ uint8_t SD_init(cmd_format* _cmd, uint8_t* _arg_cmds , resp* _respbox){
 
 	return 0x00;
 }
+
+
+/**
+ * @brief Selects the SPI prescaler of the link, re-initializes the SPI peripheral.
+ * @param uint8_t rate passes the rate index, 0 is the slowest (prescaler 256) and SD_LINK_RATES-1 the fastest (prescaler 2).
+ * @retval uint8_t returns SD_OK on success else SD_ERR_CMD.
+ */
+uint8_t SD_SetLinkRate(uint8_t rate){
+	if(rate>=SD_LINK_RATES){
+		return SD_ERR_CMD;
+	}
+	(HSPI_STRUCT_PTR)->Init.BaudRatePrescaler=link_prescaler[rate];
+	if(HAL_SPI_Init(HSPI_STRUCT_PTR)!=HAL_OK){
+		return SD_ERR_CMD;
+	}
+	SD_Link.rate=rate;
+	return SD_OK;
+}
+
+/**
+ * @brief accounts the exit status of a block read/write, lowers the link rate by one step once CRC/token errors within the window reach SD_LINK_ERR_THRESHOLD.
+ * @param uint8_t status passes the exit status of the block read/write.
+ * @param uint16_t count passes the number of blocks read or written.
+ * @retval void
+ */
+static void SD_LinkAccount(uint8_t status, uint16_t count){
+	if(SD_Link.calibrating){
+		return;
+	}
+
+	if((uint32_t)SD_Link.blocks+count>=SD_LINK_ERR_WINDOW){
+		SD_Link.blocks=0;
+		SD_Link.errors=0;
+	}else{
+		SD_Link.blocks+=count;
+	}
+	if(status!=SD_ERR_CRC && status!=SD_ERR_TOKEN){
+		return;
+	}
+
+	if(++SD_Link.errors>=SD_LINK_ERR_THRESHOLD && SD_Link.rate>SD_Link.min_rate){
+		vcom_printf("SPI link errors, lowering rate %d -> %d\r\n",SD_Link.rate,SD_Link.rate-1);
+		SD_SetLinkRate(SD_Link.rate-1);
+		SD_Link.max_rate=SD_Link.rate;
+		SD_Link.errors=0;
+		SD_Link.blocks=0;
+	}
+}
+
+/**
+ * @brief prepares the 4 byte argument (MSB first) for the block IO commands.
+ * @param uint8_t* arg passes the pointer to the 4 byte argument array.
+ * @param uint32_t sector passes the index of the sector.
+ * @retval void
+ */
+static void SD_SectorArg(uint8_t* arg, uint32_t sector){
+	uint32_t addr=SD_SECTOR_ADDR(sector);
+	arg[0]=(uint8_t)(addr>>24);
+	arg[1]=(uint8_t)(addr>>16);
+	arg[2]=(uint8_t)(addr>>8);
+	arg[3]=(uint8_t)(addr);
+}
+
+/**
+ * @brief Reads a single block (CMD17) and verifies its CRC16, selects and de-selects the chip itself.
+ * @param uint32_t sector passes the index of the sector to be read.
+ * @param uint8_t* buffer passes the pointer to SD_BLOCK_SIZE bytes of memory where the block has to be stored.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_ReadBlock(uint32_t sector, uint8_t* buffer){
+	uint8_t status=SD_OK;
+	uint16_t crc;
+
+	SD_SectorArg(arg_cmds,sector);
+	uint8_t* r1=SendSD_Command(&Cmd,CMD17,arg_cmds,&response);
+	if(r1==NULL || *r1!=0x00){
+		status=SD_ERR_CMD;
+		goto exit;
+	}
+
+	// start token may already be among the bytes of the command burst.
+	status=SD_ReceiveData(buffer,SD_BLOCK_SIZE,&crc,SD_READ_TIMEOUT_MS);
+	if(status!=SD_OK){
+		goto exit;
+	}
+
+	if(getCRC16(buffer,SD_BLOCK_SIZE)!=crc){
+		status=SD_ERR_CRC;
+	}
+
+exit:
+	SD_Deselect();
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+	SD_LinkAccount(status,1);
+	return status;
+}
+
+/**
+ * @brief sends one data block with its start token and checks the data response, chip must be selected and card must be ready.
+ * @param uint8_t token passes the start token of the block.
+ * @param uint8_t* block passes the pointer to SD_BLOCK_SIZE bytes of data.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+static uint8_t SD_SendDataBlock(uint8_t token, uint8_t* block){
+	// CRC is checked by the card only once enabled by CMD59, dummy CRC is sent otherwise.
+	uint8_t tail_tx[3]={DUMMY_BYTE,DUMMY_BYTE,DUMMY_BYTE};
+	uint8_t tail_rx[3];
+
+	if(SD_Link.crc_on){
+		uint16_t crc=getCRC16(block,SD_BLOCK_SIZE);
+		tail_tx[0]=(uint8_t)(crc>>8);
+		tail_tx[1]=(uint8_t)(crc);
+	}
+
+	if(SD_TransmitBytes(&token,1)!=1 || SD_TransmitBytes(block,SD_BLOCK_SIZE)!=SD_BLOCK_SIZE){
+		return SD_ERR_WRITE;
+	}
+	// CRC16 followed by the data response, in one transaction.
+	if(HAL_SPI_TransmitReceive(HSPI_STRUCT_PTR, tail_tx, tail_rx, sizeof(tail_tx), HAL_MAX_DELAY)!=HAL_OK){
+		return SD_ERR_WRITE;
+	}
+	switch(tail_rx[2]&DATA_RESP_MASK){
+		case DATA_RESP_ACCEPTED :	break;
+		case DATA_RESP_CRC_ERR :	return SD_ERR_CRC;
+		default :					return SD_ERR_WRITE;
+	}
+	if(SD_WaitReady(SD_BUSY_TIMEOUT_MS)!=0x00){
+		return SD_ERR_BUSY;
+	}
+	return SD_OK;
+}
+
+/**
+ * @brief Writes consecutive blocks, single block write (CMD24) for one block else multiple block write (CMD25), selects and de-selects the chip itself.
+ * @param uint32_t sector passes the index of the first sector to be written.
+ * @param uint8_t* buffer passes the pointer to count*SD_BLOCK_SIZE bytes of data to be written.
+ * @param uint16_t count passes the number of blocks to be written.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_WriteBlocks(uint32_t sector, uint8_t* buffer, uint16_t count){
+	uint8_t status=SD_OK;
+
+	if(count==0){
+		return SD_OK;
+	}
+
+	SD_SectorArg(arg_cmds,sector);
+	uint8_t* r1=SendSD_Command(&Cmd,(count==1)?CMD24:CMD25,arg_cmds,&response);
+	if(r1==NULL || *r1!=0x00){
+		status=SD_ERR_CMD;
+		goto exit;
+	}
+
+	// one byte gap (NWR) before the first data token.
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+
+	if(count==1){
+		status=SD_SendDataBlock(TOKEN_START_BLOCK,buffer);
+		goto exit;
+	}
+
+	for(uint16_t blk=0;blk<count;blk++){
+		status=SD_SendDataBlock(TOKEN_START_MULTI_WR,&buffer[(uint32_t)blk*SD_BLOCK_SIZE]);
+		if(status!=SD_OK){
+			break;
+		}
+	}
+
+	// stop transmission token ends the multiple block write even after a failed block.
+	uint8_t stop=TOKEN_STOP_TRAN;
+	SD_TransmitBytes(&stop,1);
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+	if(SD_WaitReady(SD_BUSY_TIMEOUT_MS)!=0x00 && status==SD_OK){
+		status=SD_ERR_BUSY;
+	}
+
+exit:
+	SD_Deselect();
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+	SD_LinkAccount(status,count);
+	return status;
+}
+
+/**
+ * @brief Reads the CSD register (CMD9) and verifies its CRC16, selects and de-selects the chip itself.
+ * @param uint8_t* csd passes the pointer to 16 bytes of memory where the CSD has to be stored.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx.
+ */
+uint8_t SD_ReadCSD(uint8_t* csd){
+	uint8_t status=SD_OK;
+	uint16_t crc;
+
+	SET_ARG_CMDS(0x00);
+	uint8_t* r1=SendSD_Command(&Cmd,CMD9,arg_cmds,&response);
+	if(r1==NULL || *r1!=0x00){
+		status=SD_ERR_CMD;
+	}else{
+		status=SD_ReceiveData(csd,CSD_SIZE,&crc,SD_READ_TIMEOUT_MS);
+		if(status==SD_OK && getCRC16(csd,CSD_SIZE)!=crc){
+			status=SD_ERR_CRC;
+		}
+	}
+
+	SD_Deselect();
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+	return status;
+}
+
+/**
+ * @brief decodes the TRAN_SPEED field of the CSD i.e. the maximum clock of the card in the current bus speed mode.
+ * @param uint8_t tran_speed passes the TRAN_SPEED byte.
+ * @retval uint32_t returns the clock in Hz, 0 for reserved encodings.
+ */
+static uint32_t SD_TranSpeedHz(uint8_t tran_speed){
+	static const uint32_t unit[4]={10000,100000,1000000,10000000};	// transfer rate unit divided by 10.
+	static const uint8_t mult[16]={0,10,12,13,15,20,25,30,35,40,45,50,55,60,70,80};	// time value multiplied by 10.
+
+	if((tran_speed&0x07)>3){
+		return 0;
+	}
+	return unit[tran_speed&0x07]*mult[(tran_speed>>3)&0x0F];
+}
+
+/**
+ * @brief enables or disables CRC checking of commands and data by the card (CMD59), selects and de-selects the chip itself.
+ * @param uint8_t on passes 1 to enable and 0 to disable CRC checking.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_CMD.
+ */
+static uint8_t SD_SetCRC(uint8_t on){
+	SET_ARG_CMDS(0x00);
+	arg_cmds[3]=on;
+	uint8_t* r1=SendSD_Command(&Cmd,CMD59,arg_cmds,&response);
+	SD_Deselect();
+	SD_SendDummyBytes(HSPI_STRUCT_PTR,1);
+	if(r1==NULL || *r1!=0x00){
+		return SD_ERR_CMD;
+	}
+	SD_Link.crc_on=on;
+	return SD_OK;
+}
+
+/**
+ * @brief fills the test pattern with fast edges, long runs and every byte value i.e. 0x55/0xAA, 0x00/0xFF runs, walking ones and a counter, scrambled per rate so data left by another rate never passes.
+ * @param uint8_t* pattern passes the pointer to SD_BLOCK_SIZE bytes of memory.
+ * @param uint8_t rate passes the rate under test.
+ * @retval void
+ */
+static void SD_LinkPattern(uint8_t* pattern, uint8_t rate){
+	uint8_t seed=(uint8_t)(rate*0x3B);
+	for(uint16_t i=0;i<SD_BLOCK_SIZE;i++){
+		switch(i>>7){
+			case 0 :	pattern[i]=(i&1)?0xAA:0x55;					break;
+			case 1 :	pattern[i]=(i&0x10)?0xFF:0x00;				break;
+			case 2 :	pattern[i]=(uint8_t)(1U<<(i&7));			break;
+			default :	pattern[i]=(uint8_t)i;						break;
+		}
+		pattern[i]^=seed;
+	}
+}
+
+/**
+ * @brief writes the pattern of the current rate to the scratch sector and reads it back, write CRC is checked by the card and read CRC by the host.
+ * @param uint32_t sector passes the scratch sector.
+ * @param uint8_t* pattern passes the pointer to the work memory for the pattern.
+ * @param uint8_t* readback passes the pointer to the work memory for read back data.
+ * @retval uint8_t returns SD_OK if write and every read pass match else SD_ERR_xx of the first failure.
+ */
+static uint8_t SD_LinkVerify(uint32_t sector, uint8_t* pattern, uint8_t* readback){
+	SD_LinkPattern(pattern,SD_Link.rate);
+
+	uint8_t status=SD_WriteBlocks(sector,pattern,1);
+	if(status!=SD_OK){
+		return status;
+	}
+
+	for(uint8_t pass=0;pass<SD_CALIB_PASSES;pass++){
+		status=SD_ReadBlock(sector,readback);
+		if(status!=SD_OK){
+			return status;
+		}
+		if(memcmp(pattern,readback,SD_BLOCK_SIZE)!=0){
+			return SD_ERR_CRC;	// corruption not caught by CRC16, treated as CRC failure.
+		}
+	}
+	return SD_OK;
+}
+
+/**
+ * @brief Finds the fastest reliable SPI clock, must be called after SD_init().  CRC checking is enabled (CMD59) and at every rate up to the card maximum (CSD TRAN_SPEED, SD_LINK_DEFAULT_MAX_HZ if CSD is unreadable) a pattern is written to the scratch sector and read back, first CRC, token or data error stops the search, chosen rate is backed off by SD_CALIB_MARGIN.
+ * @param uint32_t scratch_sector passes the sector which can be overwritten by the calibration.
+ * @param uint8_t* pattern passes the pointer to SD_BLOCK_SIZE bytes of work memory for the test pattern.
+ * @param uint8_t* readback passes the pointer to SD_BLOCK_SIZE bytes of work memory for the read back data.
+ * @retval uint8_t returns SD_OK on success else SD_ERR_xx of the CRC enable or pattern write/verify at the starting rate.
+ */
+uint8_t SD_LinkCalibrate(uint32_t scratch_sector, uint8_t* pattern, uint8_t* readback){
+	uint8_t base=0;
+	uint8_t status;
+	uint8_t csd[CSD_SIZE];
+
+	// starting from the rate SD_init() ran at.
+	for(uint8_t rate=0;rate<SD_LINK_RATES;rate++){
+		if(link_prescaler[rate]==(HSPI_STRUCT_PTR)->Init.BaudRatePrescaler){
+			base=rate;
+			break;
+		}
+	}
+
+	SD_Link.calibrating=1;
+	SD_Link.min_rate=base;
+	SD_Link.rate=base;
+	SD_Link.max_rate=base;
+
+	// card maximum clock in the current bus speed mode.
+	SD_Link.max_hz=0;
+	if(SD_ReadCSD(csd)==SD_OK){
+		SD_Link.max_hz=SD_TranSpeedHz(csd[CSD_TRAN_SPEED]);
+	}
+	if(SD_Link.max_hz==0 || SD_Link.max_hz>SD_LINK_SPEC_MAX_HZ){
+		SD_Link.max_hz=SD_LINK_DEFAULT_MAX_HZ;
+	}
+
+	status=SD_SetCRC(1);
+	if(status==SD_OK){
+		status=SD_LinkVerify(scratch_sector,pattern,readback);
+	}
+	if(status!=SD_OK){
+		vcom_printf("Link calibration failed at base rate : %d\r\n",status);
+		SD_Link.calibrating=0;
+		return status;
+	}
+
+	uint8_t good=base;
+	for(uint8_t rate=base+1;rate<SD_LINK_RATES;rate++){
+		if(SD_SPI_CLOCK_HZ()/link_divider[rate]>SD_Link.max_hz){
+			break;
+		}
+		if(SD_SetLinkRate(rate)!=SD_OK){
+			break;
+		}
+		status=SD_LinkVerify(scratch_sector,pattern,readback);
+		vcom_printf("Link rate %d : %d\r\n",rate,status);
+		if(status!=SD_OK){
+			break;
+		}
+		good=rate;
+	}
+
+	good=(good-base>=SD_CALIB_MARGIN)?(good-SD_CALIB_MARGIN):base;
+	SD_SetLinkRate(good);
+
+	// the failed rate may have left the card mid-transfer, chosen rate has to pass once more, else falling back to the base rate.
+	if(good!=base && SD_LinkVerify(scratch_sector,pattern,readback)!=SD_OK){
+		good=base;
+		SD_SetLinkRate(good);
+	}
+
+#if SD_LINK_WRITE_CRC == 0
+	SD_SetCRC(0);
+#endif
+
+	SD_Link.max_rate=good;
+	SD_Link.errors=0;
+	SD_Link.blocks=0;
+	SD_Link.calibrating=0;
+	return SD_OK;
+}